@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // tee(2) y splice(2)
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -6,6 +7,8 @@
 #include <fcntl.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
+#include <limits.h>
 #include "parser.h"
 
 #define MAX_JOBS 256
@@ -22,12 +25,61 @@ job_t jobs[MAX_JOBS];
 int job_count = 0;
 int next_job_id = 1;
 
+int ultimo_estado = 0; // estado de salida del último pipeline, se expande como $?
+int pipefail = 0; // con "set -o pipefail" el estado es el del último mandato que falle
+
+#define MAX_CACHE 32
+
+#define MAX_PIPELINES 512 // una línea de 1024 caracteres no puede tener más
+
+// Entrada de la caché de líneas ya tokenizadas
+typedef struct {
+    char linea[1024]; // texto exacto de la línea
+    char *path; // PATH con el que se resolvieron los mandatos
+    char *cwd; // directorio actual si algún mandato se resolvió con ruta relativa, NULL si no
+    tline line; // copia propia del pipeline (argv, filename y redirecciones)
+    unsigned long uso; // marca del último uso, para descartar la menos usada recientemente
+    int valida;
+} cache_t;
+
+cache_t cache[MAX_CACHE];
+unsigned long cache_reloj = 0;
+unsigned long cache_aciertos = 0;
+unsigned long cache_fallos = 0;
+
 void manejador_hijos(int sig); // Declaración del manejador de SIGCHILD
 
 void fg(char* index); // Función para manejar el paso de comandos de bg a fg
 
+int ejecutar_lista(char *buff, int modo_c); // Ejecuta una lista de pipelines separados por ;, && y ||
+
+int ejecutar_linea(char *buff, int modo_c, int usar_cache); // Ejecuta una línea y devuelve su estado de salida
+
+void cerrar_ficheros(int input_fd, int output_fd, int error_fd, int tap_fd); // Cierra los descriptores de redirección y del tee interno abiertos
+
+void liberar_pipes(int **pipefd, int npipes); // Cierra y libera los pipes del pipeline
+
+int derivar_tee(int entrada, int salida, int fichero); // tee interno: copia un pipe a otro y a un fichero sin pasar por espacio de usuario
+
+tline *cache_buscar(char *buff); // Devuelve el pipeline ya preparado para esa línea o NULL
+void cache_guardar(char *buff, tline *line); // Guarda una copia del pipeline de la línea
+
 
-int main() {
+int main(int argc, char *argv[]) {
+
+    // Modo -c: ejecutamos una única línea y salimos con su estado, sin prompt ni manejadores de señales
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "msh: -c: se requiere un argumento\n");
+            return 2;
+        }
+        char buff[1024];
+        if (snprintf(buff, sizeof(buff), "%s\n", argv[2]) >= (int) sizeof(buff)) {
+            fprintf(stderr, "msh: -c: la línea es demasiado larga\n");
+            return 2;
+        }
+        return ejecutar_lista(buff, 1);
+    }
 
     // Ignoramos las señales SIGINT y SIGQUIT
     signal(SIGINT, SIG_IGN);
@@ -46,236 +98,433 @@ int main() {
             break; // Si se alcanza EOF, salir del bucle principal
         }
 
-        // Tokenizamos la entrada con el parser
-        tline *line;
-        line  = tokenize(buff);
+        ejecutar_lista(buff, 0);
+    }
+    return 0;
+}
+
+// Separa la línea en pipelines unidos por ;, && y ||, comprueba la sintaxis de toda la
+// lista y después los ejecuta en orden. && y || sólo ejecutan el siguiente pipeline
+// según el estado del anterior.
+int ejecutar_lista(char *buff, int modo_c) {
+    char *inicios[MAX_PIPELINES]; // comienzo de cada pipeline dentro de buff
+    char *fines[MAX_PIPELINES];   // final (exclusivo) de cada pipeline
+    char ops[MAX_PIPELINES];      // operador que lo precede: ';', '&' (&&) o '|' (||)
+    int npipelines = 0;
+    char op = ';';
+    char *p = buff;
+
+    // Primera pasada: separamos y validamos la lista completa sin ejecutar nada
+    while (1) {
+        // Buscamos el final del pipeline actual
+        char *fin = p;
+        char sig = '\0';
+        while (*fin != '\0' && *fin != '\n') {
+            if (*fin == ';') {
+                sig = ';';
+                break;
+            }
+            if ((fin[0] == '&' && fin[1] == '&') || (fin[0] == '|' && fin[1] == '|')) {
+                sig = fin[0];
+                break;
+            }
+            fin++;
+        }
 
-        // MANDATOS INTERNOS
-        //CD
-        if (strcmp(buff, "cd\n") == 0 || strncmp(buff, "cd ", 3) == 0) {
+        char *inicio = p;
+        while (inicio < fin && (*inicio == ' ' || *inicio == '\t')) {
+            inicio++;
+        }
+        char *final = fin;
+        while (final > inicio && (final[-1] == ' ' || final[-1] == '\t')) {
+            final--;
+        }
 
-            char *dir = strtok(buff + 3, "\n"); // Extraer el directorio del argumento
-            if (dir == NULL) {
-                // Si no se proporciona argumento, usar $HOME como destino
-                dir = getenv("HOME");
-                if (dir == NULL) {
-                    fprintf(stderr, "Error: no se pudo obtener el directorio HOME\n");
-                }
+        if (inicio == final) {
+            // Sólo se admite vacío el final de la línea tras un ';' (o la línea entera)
+            if (sig != '\0' || op != ';') {
+                fprintf(stderr, "Error de sintaxis: pipeline vacío\n");
+                ultimo_estado = 2;
+                return ultimo_estado;
             }
-            // Intentar cambiar al directorio especificado
-            if (chdir(dir) == -1) {
-                fprintf(stderr, "Error al cambiar de directorio\n");
+        } else {
+            if (npipelines == MAX_PIPELINES) {
+                fprintf(stderr, "Error: demasiados pipelines en la línea\n");
+                ultimo_estado = 2;
+                return ultimo_estado;
             }
+            inicios[npipelines] = inicio;
+            fines[npipelines] = final;
+            ops[npipelines] = op;
+            npipelines++;
+        }
 
-        // JOBS
-        } else if (strcmp(buff, "jobs\n") == 0) {
-            for (int i = 0; i < job_count; i++) {
-                if (jobs[i].active) {
-                    printf("[%d]+ %-7s %s\n", jobs[i].id, jobs[i].status, jobs[i].command);
+        if (sig == '\0') {
+            break;
+        }
+        op = sig;
+        p = fin + (sig == ';' ? 1 : 2);
+    }
+
+    // Segunda pasada: ejecutamos los pipelines
+    for (int i = 0; i < npipelines; i++) {
+        if (!(ops[i] == ';' || (ops[i] == '&' && ultimo_estado == 0) || (ops[i] == '|' && ultimo_estado != 0))) {
+            continue;
+        }
+
+        // Copiamos el pipeline sustituyendo $? por el estado del anterior
+        char segmento[1024];
+        size_t n = 0;
+        for (char *c = inicios[i]; c < fines[i] && n < sizeof(segmento) - 2; c++) {
+            if (c[0] == '$' && c + 1 < fines[i] && c[1] == '?') {
+                n += snprintf(segmento + n, sizeof(segmento) - 1 - n, "%d", ultimo_estado);
+                if (n > sizeof(segmento) - 2) {
+                    n = sizeof(segmento) - 2;
                 }
+                c++;
+            } else {
+                segmento[n++] = *c;
+            }
+        }
+        segmento[n++] = '\n'; // los mandatos internos esperan la línea terminada en \n
+        segmento[n] = '\0';
+
+        // En modo -c sólo el último pipeline puede sustituir al shell
+        // En modo -c no se usa la caché: cada línea se ejecuta una sola vez
+        ultimo_estado = ejecutar_linea(segmento, modo_c && i == npipelines - 1, !modo_c);
+    }
+    return ultimo_estado;
+}
+
+// Ejecuta una línea (mandato interno o pipeline) y devuelve el estado del último mandato.
+// En modo -c el último mandato sustituye al propio shell en lugar de crear un hijo.
+int ejecutar_linea(char *buff, int modo_c, int usar_cache) {
+
+    tline *line;
+
+    // MANDATOS INTERNOS
+    //CD
+    if (strcmp(buff, "cd\n") == 0 || strncmp(buff, "cd ", 3) == 0) {
+
+        char *dir = strtok(buff + 3, "\n"); // Extraer el directorio del argumento
+        if (dir == NULL) {
+            // Si no se proporciona argumento, usar $HOME como destino
+            dir = getenv("HOME");
+            if (dir == NULL) {
+                fprintf(stderr, "Error: no se pudo obtener el directorio HOME\n");
             }
-        // FG
-        } else if (strcmp(buff, "fg\n") == 0 || strncmp(buff, "fg ", 2) == 0) {
+        }
+        // Intentar cambiar al directorio especificado
+        if (dir == NULL || chdir(dir) == -1) {
+            fprintf(stderr, "Error al cambiar de directorio\n");
+            return 1;
+        }
 
-            char *index = strtok(buff + 3, "\n");
-            fg(index);
+    // JOBS
+    } else if (strcmp(buff, "jobs\n") == 0) {
+        for (int i = 0; i < job_count; i++) {
+            if (jobs[i].active) {
+                printf("[%d]+ %-7s %s\n", jobs[i].id, jobs[i].status, jobs[i].command);
+            }
         }
+    // FG
+    } else if (strcmp(buff, "fg\n") == 0 || strncmp(buff, "fg ", 2) == 0) {
 
-        // MANDATOS QUE NO SON INTERNOS
+        char *index = strtok(buff + 3, "\n");
+        fg(index);
 
-        else {
-            
-            int input_fd = -1;  // Descriptor de ficher para redirección de entrada
-            int output_fd = -1; // Descriptor de fichero para redirección de salida
-            int error_fd = -1; // Descriptor de fichero para redirección de error
+    // SET
+    } else if (strcmp(buff, "set -o pipefail\n") == 0 || strcmp(buff, "set +o pipefail\n") == 0) {
+        pipefail = buff[4] == '-';
 
-            if (line != NULL) {
-            // Manejo de redirección de entrada
-            if (line->redirect_input) {
-                input_fd = open(line->redirect_input, O_RDONLY);
-                if (input_fd == -1 ) {
-                    fprintf(stderr, "fichero: Error al abrir el archivo de entrada (%s)\n", line->redirect_input);
-                    return -1;
-                }
+    // CACHE
+    } else if (strcmp(buff, "cache\n") == 0) {
+        unsigned long total = cache_aciertos + cache_fallos;
+        printf("aciertos: %lu fallos: %lu (%.1f%%)\n", cache_aciertos, cache_fallos,
+               total ? 100.0 * cache_aciertos / total : 0.0);
+    }
+
+    // MANDATOS QUE NO SON INTERNOS
+
+    else {
+        
+        int input_fd = -1;  // Descriptor de ficher para redirección de entrada
+        int output_fd = -1; // Descriptor de fichero para redirección de salida
+        int error_fd = -1; // Descriptor de fichero para redirección de error
+
+        // Si la línea ya se ha ejecutado con el mismo PATH (y cwd) no hace falta volver a tokenizarla
+        line = usar_cache ? cache_buscar(buff) : NULL;
+        if (line == NULL) {
+            line = tokenize(buff);
+            if (usar_cache && line != NULL) {
+                cache_guardar(buff, line);
             }
+        }
 
-            // Manejo de redirección de salida
-            if (line->redirect_output) {
-                output_fd = open(line->redirect_output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (output_fd == -1) {
-                    fprintf(stderr, "fichero: Error al abrir o crear el archivo de salida (%s)\n", line->redirect_output);
-                    return -1;                
-                }
+        if (line != NULL) {
+        // Manejo de redirección de entrada
+        if (line->redirect_input) {
+            input_fd = open(line->redirect_input, O_RDONLY);
+            if (input_fd == -1 ) {
+                fprintf(stderr, "fichero: Error al abrir el archivo de entrada (%s)\n", line->redirect_input);
+                return 1;
+            }
+        }
+
+        // Manejo de redirección de salida
+        if (line->redirect_output) {
+            output_fd = open(line->redirect_output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (output_fd == -1) {
+                fprintf(stderr, "fichero: Error al abrir o crear el archivo de salida (%s)\n", line->redirect_output);
+                cerrar_ficheros(input_fd, output_fd, error_fd, -1);
+                return 1;
+            }
+        }
+        
+        // Manejo de redirección de error
+        if (line->redirect_error) {
+            error_fd = open(line->redirect_error, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (error_fd == -1) {
+                fprintf(stderr, "fichero: Error al abrir o crear el archivo para redireccón de error (%s)\n", line->redirect_error);
+                cerrar_ficheros(input_fd, output_fd, error_fd, -1);
+                return 1;
             }
-            
-            // Manejo de redirección de error
-            if (line->redirect_error) {
-                error_fd = open(line->redirect_error, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (error_fd == -1) {
-                    fprintf(stderr, "fichero: Error al abrir o crear el archivo para redireccón de error (%s)\n", line->redirect_error);
-                    return -1;                
+        }
+
+        int numcommands = line->ncommands;
+
+        // tee interno: un "tee fichero" entre dos mandatos no se ejecuta como /usr/bin/tee,
+        // sino que duplicamos el pipe con tee(2) + splice(2). En fg lo hace el propio shell.
+        int tap = -1;       // índice del mandato tee que sustituimos
+        int tap_fd = -1;    // fichero destino de la derivación
+        for (int i = 1; i < numcommands - 1; i++) {
+            tcommand *cmd = &line->commands[i];
+            // Sólo "tee fichero": cualquier opción (-a, -i...) la resuelve el tee externo
+            if (cmd->argc == 2 && strcmp(cmd->argv[0], "tee") == 0 && cmd->argv[1][0] != '-') {
+                tap_fd = open(cmd->argv[1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (tap_fd == -1) {
+                    fprintf(stderr, "tee: Error al abrir o crear el archivo (%s)\n", cmd->argv[1]);
+                    cerrar_ficheros(input_fd, output_fd, error_fd, -1);
+                    return 1;
                 }
+                tap = i;
+                break;
             }
+        }
+        int tap_shell = tap != -1 && line->background == 0;
 
-            int numcommands = line->ncommands;
+        // int pipefd[numcommands - 1][2];
+        // Pipes con memoria dinámica
 
-            // int pipefd[numcommands - 1][2];
-            // Pipes con memoria dinámica
+        int **pipefd = malloc((numcommands - 1) * sizeof(int *));
+        if (pipefd == NULL) {
+            fprintf(stderr, "Error al reservar memoria para los pipes\n");
+            cerrar_ficheros(input_fd, output_fd, error_fd, tap_fd);
+            return 1;
+        }
 
-            int **pipefd = malloc((numcommands - 1) * sizeof(int *));
-            if (pipefd == NULL) {
-                fprintf(stderr, "Error al reservar memoria para los pipes\n");
-                return -1;
+        // Reservamos memoria para cada pipe (dos enteros: lectura y escritura)
+        for (int i = 0; i < numcommands - 1; i++) {
+            pipefd[i] = malloc(2 * sizeof(int));
+            if (pipefd[i] == NULL) {
+                fprintf(stderr, "Error al reservar memoria para el pipe %d\n", i);
+                // Cerramos y liberamos los pipes ya creados
+                liberar_pipes(pipefd, i);
+                cerrar_ficheros(input_fd, output_fd, error_fd, tap_fd);
+                return 1;
             }
 
-            // Reservamos memoria para cada pipe (dos enteros: lectura y escritura)
-            for (int i = 0; i < numcommands - 1; i++) {
-                pipefd[i] = malloc(2 * sizeof(int));
-                if (pipefd[i] == NULL) {
-                    fprintf(stderr, "Error al reservar memoria para el pipe %d\n", i);
-                    // Liberamos la memoria previamente asignada
+            // Crea el pipe
+            if (pipe(pipefd[i]) == -1) {
+                fprintf(stderr, "Error al crear el pipe %d\n", i);
+                // Cerramos y liberamos los pipes ya creados
+                free(pipefd[i]);
+                liberar_pipes(pipefd, i);
+                cerrar_ficheros(input_fd, output_fd, error_fd, tap_fd);
+                return 1;
+            }
+        }
+        // pipe[X][1] --> entrada / escritura
+        // pipe[X][0] --> salida / lectura
+
+
+        // En modo -c, si el pipeline no va en background, el último mandato no necesita
+        // que el shell haga nada después: lo ejecutamos en el propio proceso sin fork.
+        // Con pipefail hay que recoger el estado de los anteriores, así que sólo si es el único.
+        int reemplazar = modo_c && line->background == 0 && !tap_shell && (!pipefail || numcommands == 1);
+        // pids de los mandatos, para recoger el estado de cada uno
+        pid_t *pids = malloc(numcommands * sizeof(pid_t));
+        if (pids == NULL) {
+            fprintf(stderr, "Error al reservar memoria para los procesos\n");
+            liberar_pipes(pipefd, numcommands - 1);
+            cerrar_ficheros(input_fd, output_fd, error_fd, tap_fd);
+            return 1;
+        }
+
+        // Bloqueamos SIGCHLD hasta recoger a los hijos (incluido el tiempo que el shell hace de tee)
+        // para que manejador_hijos no se adelante y nos quite su estado de salida
+        sigset_t bloqueo, anterior;
+        sigemptyset(&bloqueo);
+        sigaddset(&bloqueo, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &bloqueo, &anterior);
+
+        // Vaciamos los buffers antes de crear hijos o de sustituir al shell: si no, lo que haya
+        // escrito un mandato interno anterior se perdería o lo volcaría un hijo en su salida
+        fflush(stdout);
+        fflush(stderr);
+
+        // Ejecutamos los comandos en los procesos hijos
+        for (int i = 0; i < numcommands; i++) {
+            pids[i] = -1;
+            if (tap_shell && i == tap) {
+                continue; // la derivación la hace el shell cuando estén lanzados los demás
+            }
+            pid_t pid = (reemplazar && i == numcommands - 1) ? 0 : fork();
+
+            if (pid == -1) {
+                fprintf(stderr, "Error al crear el proceso hijo\n");
+                // Cerramos los pipes para que los hijos ya creados terminen y los recogemos
+                liberar_pipes(pipefd, numcommands - 1);
+                cerrar_ficheros(input_fd, output_fd, error_fd, tap_fd);
+                if (line->background == 0) {
                     for (int j = 0; j < i; j++) {
-                        free(pipefd[j]);
+                        if (pids[j] != -1) {
+                            waitpid(pids[j], NULL, 0);
+                        }
                     }
-                    free(pipefd);
-                    return -1;
+                }
+                sigprocmask(SIG_SETMASK, &anterior, NULL);
+                free(pids);
+                return 1;
+            }
+            pids[i] = pid;
+
+            if (pid == 0) {
+                sigprocmask(SIG_SETMASK, &anterior, NULL); // el mandato no debe heredar SIGCHLD bloqueada
+                // Restauramos el funcionamiento de las señales SIGINT y SIGQUIT para los procesos hijos ejecutados en fg
+                if (line->background == 0) {
+                    signal(SIGINT, SIG_DFL);
+                    signal(SIGQUIT, SIG_DFL);
                 }
 
-                // Crea el pipe
-                if (pipe(pipefd[i]) == -1) {
-                    fprintf(stderr, "Error al crear el pipe %d\n", i);
-                    // Liberamos la memoria asignada
-                    for (int j = 0; j <= i; j++) {
-                        free(pipefd[j]);
-                    }
-                    free(pipefd);
-                    return -1;
+                // Si hay redirección de entrada (para el primer mandato)
+                if (input_fd != -1 && i == 0) {
+                    dup2(input_fd, STDIN_FILENO); // Redirigimos la entrada estándar del proceso
+                    close(input_fd); // cerramos el descriptor de fichero
                 }
-            }
-            // pipe[X][1] --> entrada / escritura
-            // pipe[X][0] --> salida / lectura
-
-            // Creamos los pipes necesarios para los comandos
-            for (int i = 0; i < numcommands - 1; i++) {
-                if (pipe(pipefd[i]) == -1) {
-                    fprintf(stderr, "Error al crear el pipe\n");
-                    if (input_fd != -1) {
-                        close(input_fd);
-                    }
+                // Si no es el primer mandato
+                if (i > 0) {
+                    dup2(pipefd[i - 1][0], STDIN_FILENO); // redirigimos la entrada desde el pipe anterior
+                    close(pipefd[i - 1][0]); // cerramos el extremo del pipe anterior
+                }
+                // Si es el último mandato comprobamos si hay redireccion de salida o error
+                if (i == numcommands - 1) {
                     if (output_fd != -1) {
-                        close(output_fd);
+                        dup2(output_fd, STDOUT_FILENO); // redirigimos la salida al archivo
+                        close(output_fd); // cerramos el descriptor de fichero
                     }
                     if (error_fd != -1) {
-                        close(error_fd);
+                        dup2(error_fd, STDERR_FILENO); // redirigimos STDERR al archivo
+                        close(error_fd); // Cerramos el descriptor de fichero
                     }
-                    return -1;
+
+                } else if (i < numcommands - 1) { // Si no hay redirección de salida
+                    dup2(pipefd[i][1], STDOUT_FILENO); // redirigimos la salida al extremo de escritura del pipe actual
+                    close(pipefd[i][1]); // cerramos el descriptor de fichero
                 }
-            }
 
-            // Ejecutamos los comandos en los procesos hijos
-            for (int i = 0; i < numcommands; i++) {
-                pid_t pid = fork();
+                // Cerramos los extremos de escritura y lectura de los pipes.
+                for (int j = 0; j < numcommands - 1; j++) {
+                    close(pipefd[j][0]);
+                    close(pipefd[j][1]);
+                }
 
-                if (pid == -1) {
-                    fprintf(stderr, "Error al crear el proceso hijo\n");
-                    return -1;
+                // tee interno en background: el hijo hace la derivación y termina sin exec
+                if (i == tap) {
+                    _exit(derivar_tee(STDIN_FILENO, STDOUT_FILENO, tap_fd) == -1 ? 1 : 0);
                 }
 
-                if (pid == 0) {
-                    // Restauramos el funcionamiento de las señales SIGINT y SIGQUIT para los procesos hijos ejecutados en fg
-                    if (line->background == 0) {
-                        signal(SIGINT, SIG_DFL);
-                        signal(SIGQUIT, SIG_DFL);
-                    }
+                tcommand *cmd = &line->commands[i];
 
-                    // Si hay redirección de entrada (para el primer mandato)
-                    if (input_fd != -1 && i == 0) {
-                        dup2(input_fd, STDIN_FILENO); // Redirigimos la entrada estándar del proceso
-                        close(input_fd); // cerramos el descriptor de fichero
-                    }
-                    // Si no es el primer mandato
-                    if (i > 0) {
-                        dup2(pipefd[i - 1][0], STDIN_FILENO); // redirigimos la entrada desde el pipe anterior
-                        close(pipefd[i - 1][0]); // cerramos el extremo del pipe anterior
-                    }
-                    // Si es el último mandato comprobamos si hay redireccion de salida o error
-                    if (i == numcommands - 1) {
-                        if (output_fd != -1) {
-                            dup2(output_fd, STDOUT_FILENO); // redirigimos la salida al archivo
-                            close(output_fd); // cerramos el descriptor de fichero
-                        }
-                        if (error_fd != -1) {
-                            dup2(error_fd, STDERR_FILENO); // redirigimos STDERR al archivo
-                            close(error_fd); // Cerramos el descriptor de fichero
-                        }
-
-                    } else if (i < numcommands - 1) { // Si no hay redirección de salida
-                        dup2(pipefd[i][1], STDOUT_FILENO); // redirigimos la salida al extremo de escritura del pipe actual
-                        close(pipefd[i][1]); // cerramos el descriptor de fichero
-                    }
-
-                    // Cerramos los extremos de escritura y lectura de los pipes.
-                    for (int j = 0; j < numcommands - 1; j++) {
-                        close(pipefd[j][0]);
-                        close(pipefd[j][1]);
-                    }
+                // El parser devuelve NULL si no existe el mandato(filename)
+                if (cmd->filename == NULL) {
+                    fprintf(stderr, "%s: No se encuentra el mandato\n", cmd->argv[0]);
+                    _exit(127);
+                }
 
-                    tcommand *cmd = &line->commands[i];
-
-                    // El parser devuelve NULL si no existe el mandato(filename)
-                    if (cmd->filename == NULL) {
-                        printf("%s: No se encuentra el mandato\n", cmd->argv[0]);
-                        return -1;
-                    }       
-
-                    execv(cmd->filename, cmd->argv);
-                    fprintf(stderr, "Error al ejecutar el comando %s\n", cmd->filename);
-                    return -1;
-
-                } else { // No somos el hijo
-                    // Añadimos el comando al array de jobs
-                    if (line->background == 1 && job_count < MAX_JOBS) {
-                        
-                        jobs[job_count].id = next_job_id++; // Asignamos un id al comando actual y lo incrementamos
-                        jobs[job_count].pid = pid; // asignamos el pid del proceso hijo
-                        jobs[job_count].active = 1; // el proceso pasa a estar activo
-                        strncpy(jobs[job_count].command, line->commands[i].filename, sizeof(jobs[job_count].command)); // Asignamos el comando
-                        strncpy(jobs[job_count].status, "Running", sizeof(jobs[job_count].status)); // Estado actual
-                        job_count++;
-                        
-                    }
+                execv(cmd->filename, cmd->argv);
+                fprintf(stderr, "Error al ejecutar el comando %s\n", cmd->filename);
+                _exit(126);
+
+            } else { // No somos el hijo
+                // Añadimos el comando al array de jobs
+                if (line->background == 1 && job_count < MAX_JOBS) {
+                    
+                    jobs[job_count].id = next_job_id++; // Asignamos un id al comando actual y lo incrementamos
+                    jobs[job_count].pid = pid; // asignamos el pid del proceso hijo
+                    jobs[job_count].active = 1; // el proceso pasa a estar activo
+                    strncpy(jobs[job_count].command, line->commands[i].filename, sizeof(jobs[job_count].command)); // Asignamos el comando
+                    strncpy(jobs[job_count].status, "Running", sizeof(jobs[job_count].status)); // Estado actual
+                    job_count++;
+                    
                 }
             }
+        }
 
-            // Cerramos los pipes del padre
-            for (int i = 0; i < numcommands - 1; i++) {
+        // Cerramos los pipes del padre, salvo los extremos que usa el tee interno
+        for (int i = 0; i < numcommands - 1; i++) {
+            if (!tap_shell || i != tap - 1) {
                 close(pipefd[i][0]);
-                close(pipefd[i][1]);
-            }
-            if (input_fd != -1) {
-                close(input_fd);
             }
-            if (output_fd != -1) {
-                close(output_fd);
+            if (!tap_shell || i != tap) {
+                close(pipefd[i][1]);
             }
-            if (error_fd != -1) {
-                close(error_fd);
+        }
+        int tap_estado = 0; // estado del tee interno, como si fuera un mandato más
+        if (tap_shell) {
+            // Si el mandato siguiente termina antes no queremos morir por SIGPIPE
+            void (*sigpipe_anterior)(int) = signal(SIGPIPE, SIG_IGN);
+            if (derivar_tee(pipefd[tap - 1][0], pipefd[tap][1], tap_fd) == -1) {
+                tap_estado = 1;
             }
+            signal(SIGPIPE, sigpipe_anterior);
+            close(pipefd[tap - 1][0]);
+            close(pipefd[tap][1]);
+        }
+        cerrar_ficheros(input_fd, output_fd, error_fd, tap_fd);
 
-            // Liberamos la memoria de la matriz dinámica de pipes
-            for (int i = 0; i < numcommands - 1; i++) {
-                free(pipefd[i]); // Libera cada pipe
-            }
-            free(pipefd); // Libera el arreglo principal
+        // Liberamos la memoria de la matriz dinámica de pipes
+        for (int i = 0; i < numcommands - 1; i++) {
+            free(pipefd[i]); // Libera cada pipe
+        }
+        free(pipefd); // Libera el arreglo principal
 
-            // Esperamos a los procesos hijos si se ha ejecutado en fg
-            if (line->background == 0) {
-                for (int i = 0; i < numcommands; i++) {
-                    wait(NULL);
+        // Esperamos a los procesos hijos si se ha ejecutado en fg
+        // El estado del pipeline es el de su último mandato, o con pipefail el del último que falle
+        int resultado = 0;
+        if (line->background == 0) {
+            for (int i = 0; i < numcommands; i++) {
+                int status;
+                int estado = 0;
+                if (tap_shell && i == tap) {
+                    estado = tap_estado;
+                } else if (pids[i] == -1 || waitpid(pids[i], &status, 0) == -1) {
+                    continue;
+                } else if (WIFEXITED(status)) {
+                    estado = WEXITSTATUS(status);
+                } else if (WIFSIGNALED(status)) {
+                    estado = 128 + WTERMSIG(status);
+                }
+                if (pipefail ? estado != 0 : i == numcommands - 1) {
+                    resultado = estado;
                 }
             }
         }
+        sigprocmask(SIG_SETMASK, &anterior, NULL);
+        free(pids);
+        return resultado;
     }
+    return 2; // Error de sintaxis en la línea
     }
     return 0;
 }
@@ -341,3 +590,195 @@ void fg(char* index) {
     strncpy(job->status, "Done", sizeof(job->status)); 
 }
 
+void cerrar_ficheros(int input_fd, int output_fd, int error_fd, int tap_fd) {
+    if (input_fd != -1) {
+        close(input_fd);
+    }
+    if (output_fd != -1) {
+        close(output_fd);
+    }
+    if (error_fd != -1) {
+        close(error_fd);
+    }
+    if (tap_fd != -1) {
+        close(tap_fd);
+    }
+}
+
+void liberar_pipes(int **pipefd, int npipes) {
+    for (int i = 0; i < npipes; i++) {
+        close(pipefd[i][0]);
+        close(pipefd[i][1]);
+        free(pipefd[i]);
+    }
+    free(pipefd);
+}
+
+int derivar_tee(int entrada, int salida, int fichero) {
+
+    while (1) {
+        // tee(2) duplica lo que hay en el pipe de entrada en el de salida sin consumirlo
+        ssize_t n = tee(entrada, salida, INT_MAX, 0);
+        if (n == 0) {
+            return 0; // EOF: el mandato anterior ha cerrado el pipe
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue; // interrumpido por SIGCHLD
+            }
+            if (errno == EPIPE) {
+                return 0; // el mandato siguiente ya no lee
+            }
+            fprintf(stderr, "tee: Error al duplicar el pipe\n");
+            return -1;
+        }
+
+        // splice(2) consume esos mismos bytes del pipe de entrada y los escribe en el fichero
+        while (n > 0) {
+            ssize_t escritos = splice(entrada, NULL, fichero, NULL, n, SPLICE_F_MOVE);
+            if (escritos == -1 && errno == EINTR) {
+                continue;
+            }
+            if (escritos <= 0) {
+                fprintf(stderr, "tee: Error al escribir en el fichero\n");
+                return -1;
+            }
+            n -= escritos;
+        }
+    }
+}
+
+// Libera la copia del pipeline guardada en una entrada de la caché
+static void cache_liberar(cache_t *e) {
+    for (int i = 0; i < e->line.ncommands; i++) {
+        for (int j = 0; j < e->line.commands[i].argc; j++) {
+            free(e->line.commands[i].argv[j]);
+        }
+        free(e->line.commands[i].argv);
+        free(e->line.commands[i].filename);
+    }
+    free(e->line.commands);
+    free(e->line.redirect_input);
+    free(e->line.redirect_output);
+    free(e->line.redirect_error);
+    free(e->path);
+    free(e->cwd);
+    e->valida = 0;
+}
+
+static char *copiar(const char *str) {
+    return str ? strdup(str) : NULL;
+}
+
+tline *cache_buscar(char *buff) {
+    char *path = getenv("PATH");
+    char cwd[1024];
+    int tiene_cwd = 0;
+
+    for (int i = 0; i < MAX_CACHE; i++) {
+        cache_t *e = &cache[i];
+        if (!e->valida || strcmp(e->linea, buff) != 0 || strcmp(e->path, path ? path : "") != 0) {
+            continue;
+        }
+        if (e->cwd != NULL) {
+            // Sólo obtenemos el directorio actual si la entrada depende de él
+            if (!tiene_cwd && getcwd(cwd, sizeof(cwd)) == NULL) {
+                continue;
+            }
+            tiene_cwd = 1;
+            if (strcmp(e->cwd, cwd) != 0) {
+                continue;
+            }
+        }
+        e->uso = ++cache_reloj;
+        cache_aciertos++;
+        return &e->line;
+    }
+    cache_fallos++;
+    return NULL;
+}
+
+void cache_guardar(char *buff, tline *line) {
+    int relativa = 0;
+
+    // No guardamos líneas vacías ni con mandatos que no existen (podrían instalarse después)
+    if (line->ncommands == 0 || strlen(buff) >= sizeof(cache[0].linea)) {
+        return;
+    }
+    for (int i = 0; i < line->ncommands; i++) {
+        if (line->commands[i].filename == NULL) {
+            return;
+        }
+        if (line->commands[i].filename[0] != '/') {
+            relativa = 1;
+        }
+    }
+
+    // Buscamos una entrada libre o, si no hay, la usada hace más tiempo
+    cache_t *e = &cache[0];
+    for (int i = 0; i < MAX_CACHE; i++) {
+        if (!cache[i].valida) {
+            e = &cache[i];
+            break;
+        }
+        if (cache[i].uso < e->uso) {
+            e = &cache[i];
+        }
+    }
+    if (e->valida) {
+        cache_liberar(e);
+    }
+
+    char cwd[1024];
+    char *path = getenv("PATH");
+    e->cwd = NULL;
+    if (relativa) {
+        if (getcwd(cwd, sizeof(cwd)) == NULL) {
+            return;
+        }
+        e->cwd = strdup(cwd);
+    }
+    strcpy(e->linea, buff);
+    e->path = strdup(path ? path : "");
+
+    // Copiamos el pipeline, ya que tokenize() reutiliza su memoria en la siguiente llamada.
+    // ncommands y argc sólo cuentan lo ya copiado, para que cache_liberar() pueda deshacerlo.
+    e->line.ncommands = 0;
+    e->line.background = line->background;
+    e->line.redirect_input = copiar(line->redirect_input);
+    e->line.redirect_output = copiar(line->redirect_output);
+    e->line.redirect_error = copiar(line->redirect_error);
+    e->line.commands = malloc(line->ncommands * sizeof(tcommand));
+    int error = e->path == NULL || (relativa && e->cwd == NULL) || e->line.commands == NULL ||
+                (line->redirect_input && e->line.redirect_input == NULL) ||
+                (line->redirect_output && e->line.redirect_output == NULL) ||
+                (line->redirect_error && e->line.redirect_error == NULL);
+    for (int i = 0; i < line->ncommands && !error; i++) {
+        tcommand *origen = &line->commands[i];
+        tcommand *destino = &e->line.commands[i];
+        destino->argc = 0;
+        destino->filename = strdup(origen->filename);
+        destino->argv = malloc((origen->argc + 1) * sizeof(char *));
+        e->line.ncommands++;
+        if (destino->filename == NULL || destino->argv == NULL) {
+            error = 1;
+            break;
+        }
+        for (int j = 0; j < origen->argc; j++) {
+            destino->argv[j] = strdup(origen->argv[j]);
+            if (destino->argv[j] == NULL) {
+                error = 1;
+                break;
+            }
+            destino->argc++;
+        }
+        destino->argv[destino->argc] = NULL; // execv necesita el vector terminado en NULL
+    }
+    if (error) {
+        fprintf(stderr, "Error al reservar memoria para la caché\n");
+        cache_liberar(e);
+        return;
+    }
+    e->uso = ++cache_reloj;
+    e->valida = 1;
+}